@@ -0,0 +1,100 @@
+cmake_minimum_required(VERSION 3.19)
+
+# depfile paths are rewritten for the generator (recorded by the function below)
+if(POLICY CMP0116)
+    cmake_policy(SET CMP0116 NEW)
+endif()
+
+# rice_generate_meta(<target> [SHARDED] [SOURCE <source file>] [MANIFEST <manifest file>] <headers>...)
+#
+# Generates <header>_meta.hpp for every header with a separate custom command, so Ninja runs
+# the generators in parallel and only reruns the ones whose header or included headers changed.
+# The meta headers are placed into ${CMAKE_CURRENT_BINARY_DIR}/meta which is added to the
+# include directories of <target>.
+# SOURCE is a source file of <target> whose entry in compile_commands.json supplies the
+# include paths and definitions clang needs (requires CMAKE_EXPORT_COMPILE_COMMANDS).
+# SHARDED additionally writes one meta header per struct to <header>_meta/, which can be
+# included on their own, only changed shards are rewritten.
+# MANIFEST records every reflectable type in a project wide manifest, so types from headers
+# included by several of the headers are only generated once, into shared meta headers next to the manifest.
+# The meta header and its depfile are declared as outputs of the custom command. The shards and shared meta headers are
+# named after the structs and the headers defining them, which is unknown at configure time, so they are not declared.
+# Their directories (and the manifest) are only removed by the clean target, and sources of other targets including them
+# directly have to depend on <target>.
+function(rice_generate_meta TARGET)
+    cmake_parse_arguments(PARSE_ARGV 1 RICE_META "SHARDED" "SOURCE;MANIFEST" "")
+
+    if(TARGET RiceMetaCompiler)
+        set(META_COMPILER $<TARGET_FILE:RiceMetaCompiler>)
+        set(META_COMPILER_DEPENDS RiceMetaCompiler)
+    else()
+        find_program(META_COMPILER_PROGRAM RiceMetaCompiler REQUIRED)
+        set(META_COMPILER ${META_COMPILER_PROGRAM})
+        set(META_COMPILER_DEPENDS ${META_COMPILER_PROGRAM})
+    endif()
+
+    set(COMPILE_COMMANDS_ARGS)
+    if(RICE_META_SOURCE)
+        get_filename_component(SOURCE_PATH ${RICE_META_SOURCE} ABSOLUTE)
+        set(COMPILE_COMMANDS_ARGS source_file_path=${SOURCE_PATH}
+                                  compile_commands_path=${CMAKE_BINARY_DIR}/compile_commands.json)
+    endif()
+
+    set(SHARD_ARGS)
+    if(RICE_META_SHARDED)
+        set(SHARD_ARGS --shard)
+    endif()
+
+    set(MANIFEST_ARGS)
+    if(RICE_META_MANIFEST)
+        get_filename_component(MANIFEST_PATH ${RICE_META_MANIFEST} ABSOLUTE BASE_DIR ${CMAKE_CURRENT_BINARY_DIR})
+        set(MANIFEST_ARGS manifest_path=${MANIFEST_PATH})
+    endif()
+
+    # makefile generators only support DEPFILE since 3.20
+    set(USE_DEPFILE OFF)
+    if(CMAKE_GENERATOR MATCHES "Ninja" OR CMAKE_VERSION VERSION_GREATER_EQUAL 3.20)
+        set(USE_DEPFILE ON)
+    endif()
+
+    set(META_OUTPUT_DIR ${CMAKE_CURRENT_BINARY_DIR}/meta)
+    file(MAKE_DIRECTORY ${META_OUTPUT_DIR})
+
+    set(META_FILES)
+    set(CLEAN_FILES)
+    if(RICE_META_MANIFEST)
+        get_filename_component(MANIFEST_DIR ${MANIFEST_PATH} DIRECTORY)
+        get_filename_component(MANIFEST_NAME ${MANIFEST_PATH} NAME_WE)
+        list(APPEND CLEAN_FILES ${MANIFEST_PATH} ${MANIFEST_DIR}/${MANIFEST_NAME}_meta)
+    endif()
+    foreach(HEADER ${RICE_META_UNPARSED_ARGUMENTS})
+        get_filename_component(HEADER_PATH ${HEADER} ABSOLUTE)
+        get_filename_component(HEADER_NAME ${HEADER} NAME_WE)
+        set(META_FILE ${META_OUTPUT_DIR}/${HEADER_NAME}_meta.hpp)
+        set(DEP_FILE ${META_OUTPUT_DIR}/${HEADER_NAME}_meta.d)
+
+        set(DEPFILE_ARGS)
+        if(USE_DEPFILE)
+            set(DEPFILE_ARGS DEPFILE ${DEP_FILE})
+        endif()
+        if(RICE_META_SHARDED)
+            list(APPEND CLEAN_FILES ${META_OUTPUT_DIR}/${HEADER_NAME}_meta)
+        endif()
+
+        add_custom_command(
+            OUTPUT ${META_FILE}
+            BYPRODUCTS ${DEP_FILE}
+            COMMAND ${META_COMPILER} header_file_path=${HEADER_PATH} depfile_path=${DEP_FILE} ${SHARD_ARGS}
+                    ${MANIFEST_ARGS} ${COMPILE_COMMANDS_ARGS}
+            DEPENDS ${HEADER_PATH} ${META_COMPILER_DEPENDS}
+            ${DEPFILE_ARGS}
+            WORKING_DIRECTORY ${META_OUTPUT_DIR}
+            COMMENT "Generating reflection metadata for ${HEADER}"
+            VERBATIM)
+        list(APPEND META_FILES ${META_FILE})
+    endforeach()
+
+    target_sources(${TARGET} PRIVATE ${META_FILES})
+    set_property(TARGET ${TARGET} APPEND PROPERTY ADDITIONAL_CLEAN_FILES ${CLEAN_FILES})
+    target_include_directories(${TARGET} PRIVATE ${META_OUTPUT_DIR} ${METACOMPILER_INCLUDES})
+endfunction()
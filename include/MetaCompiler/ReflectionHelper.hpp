@@ -1,9 +1,11 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <bits/utility.h>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -123,6 +125,284 @@ BUILTIN_GEN_TYPE(wchar_t);
 
 #undef BUILTIN_GEN_TYPE
 
+// ---------------------------------------------------------------------------------------------------------------------
+// flat field layouts, generated for every reflectable struct as TypeOf<T>::layout
+// nested reflectable members are flattened into the table of the outer struct by the metacompiler
+
+enum class FieldKind {
+    Bytes, // trivially copyable without padding, compared, hashed and copied as raw memory
+    Value, // everything else, handled through the type erased operations
+};
+
+struct FieldLayout {
+    size_t offset = 0;
+    size_t size = 0;
+    FieldKind kind = FieldKind::Bytes;
+    // nullptr if the operation is not supported by the field type
+    bool (*equal)(const void *, const void *) = nullptr;
+    size_t (*hash)(const void *) = nullptr;
+    void (*copy)(void *, const void *) = nullptr;
+};
+
+template <typename T, typename = void> struct HasLayout : std::false_type {};
+template <typename T> struct HasLayout<T, std::void_t<decltype(TypeOf<T>::layout)>> : std::true_type {};
+
+template <typename T> bool equal(const T &a, const T &b);
+template <typename T> size_t hash(const T &value);
+template <typename T> void copy(T &destination, const T &source);
+
+namespace detail {
+
+template <typename T, typename = void> struct IsEqualityComparable : std::false_type {};
+template <typename T>
+struct IsEqualityComparable<T, std::void_t<decltype(std::declval<const T &>() == std::declval<const T &>())>>
+    : std::true_type {};
+
+template <typename T, typename = void> struct IsIterable : std::false_type {};
+template <typename T>
+struct IsIterable<T, std::void_t<decltype(std::begin(std::declval<const T &>())),
+                                 decltype(std::end(std::declval<const T &>()))>> : std::true_type {};
+
+template <typename T> using ElementOf = std::decay_t<decltype(*std::begin(std::declval<const T &>()))>;
+
+// operator== of containers is not constrained, it only compiles if the elements are comparable as well
+// arrays decay to pointers and are never compared by operator==
+template <typename T> constexpr bool isComparableByOperator() {
+    if constexpr (std::is_array_v<T>) {
+        return false;
+    } else if constexpr (IsIterable<T>::value) {
+        return IsEqualityComparable<T>::value && isComparableByOperator<ElementOf<T>>();
+    } else {
+        return IsEqualityComparable<T>::value;
+    }
+}
+
+template <typename T> constexpr bool isEqualityComparable() {
+    if constexpr (HasLayout<T>::value || isComparableByOperator<T>()) {
+        return true;
+    } else if constexpr (IsIterable<T>::value) {
+        return isEqualityComparable<ElementOf<T>>();
+    } else {
+        return false;
+    }
+}
+
+template <typename T> constexpr bool isHashable() {
+    if constexpr (HasLayout<T>::value || std::is_default_constructible_v<std::hash<T>>) {
+        return true;
+    } else if constexpr (IsIterable<T>::value) {
+        return isHashable<ElementOf<T>>();
+    } else {
+        return false;
+    }
+}
+
+template <typename T> constexpr bool isCopyAssignable() {
+    if constexpr (HasLayout<T>::value || std::is_copy_assignable_v<T>) {
+        return true;
+    } else if constexpr (std::is_array_v<T>) {
+        return isCopyAssignable<std::remove_extent_t<T>>();
+    } else {
+        return false;
+    }
+}
+
+constexpr uint64_t mix(uint64_t x) {
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93ULL;
+    x ^= x >> 32;
+    x *= 0xd6e8feb86659fd93ULL;
+    x ^= x >> 32;
+    return x;
+}
+
+// word at a time hash of raw memory
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ULL);
+    uint64_t word;
+    for (; size >= sizeof(word); size -= sizeof(word), bytes += sizeof(word)) {
+        std::memcpy(&word, bytes, sizeof(word));
+        h = mix(h ^ word);
+    }
+    if (size) {
+        word = 0;
+        std::memcpy(&word, bytes, size);
+        h = mix(h ^ word);
+    }
+    return h;
+}
+
+template <typename T> size_t hashValue(const T &value) {
+    if constexpr (HasLayout<T>::value) {
+        return hash(value);
+    } else if constexpr (std::is_default_constructible_v<std::hash<T>>) {
+        return std::hash<T>{}(value);
+    } else {
+        uint64_t h = 0;
+        for (const auto &element : value) {
+            h = mix(h ^ hashValue(element));
+        }
+        return h;
+    }
+}
+
+// containers and arrays whose elements have no usable operator== are compared element by element
+template <typename T> bool equalValue(const T &a, const T &b) {
+    if constexpr (HasLayout<T>::value) {
+        return equal(a, b);
+    } else if constexpr (isComparableByOperator<T>()) {
+        return a == b;
+    } else {
+        return std::equal(std::begin(a), std::end(a), std::begin(b), std::end(b),
+                          [](const auto &x, const auto &y) { return equalValue(x, y); });
+    }
+}
+
+template <typename T> void copyValue(T &destination, const T &source) {
+    if constexpr (HasLayout<T>::value) {
+        copy(destination, source);
+    } else if constexpr (std::is_array_v<T>) {
+        for (size_t i = 0; i < std::extent_v<T>; i++) {
+            copyValue(destination[i], source[i]);
+        }
+    } else {
+        destination = source;
+    }
+}
+
+template <typename T> bool equalErased(const void *a, const void *b) {
+    return equalValue(*static_cast<const T *>(a), *static_cast<const T *>(b));
+}
+
+template <typename T> size_t hashErased(const void *value) { return hashValue(*static_cast<const T *>(value)); }
+
+template <typename T> void copyErased(void *destination, const void *source) {
+    copyValue(*static_cast<T *>(destination), *static_cast<const T *>(source));
+}
+
+template <size_t N> struct MergedLayout {
+    std::array<FieldLayout, N> fields{};
+    size_t count = 0;
+};
+
+// merge adjacent byte fields without padding in between into one range
+template <size_t N> constexpr MergedLayout<N> mergeLayout(const std::array<FieldLayout, N> &layout) {
+    MergedLayout<N> merged;
+    for (size_t i = 0; i < N; i++) {
+        if (merged.count && layout[i].kind == FieldKind::Bytes) {
+            FieldLayout &last = merged.fields[merged.count - 1];
+            if (last.kind == FieldKind::Bytes && last.offset + last.size == layout[i].offset) {
+                last.size += layout[i].size;
+                continue;
+            }
+        }
+        merged.fields[merged.count++] = layout[i];
+    }
+    return merged;
+}
+
+template <typename T> struct FlatLayout {
+    static constexpr auto merged = mergeLayout(TypeOf<T>::layout);
+};
+
+template <typename T, size_t I> bool equalAt(const unsigned char *a, const unsigned char *b) {
+    constexpr FieldLayout entry = FlatLayout<T>::merged.fields[I];
+    if constexpr (entry.kind == FieldKind::Bytes) {
+        return std::memcmp(a + entry.offset, b + entry.offset, entry.size) == 0;
+    } else {
+        static_assert(entry.equal != nullptr, "field is neither reflectable nor equality comparable");
+        return entry.equal(a + entry.offset, b + entry.offset);
+    }
+}
+
+template <typename T, size_t I> uint64_t hashAt(const unsigned char *value, uint64_t h) {
+    constexpr FieldLayout entry = FlatLayout<T>::merged.fields[I];
+    if constexpr (entry.kind == FieldKind::Bytes) {
+        return hashBytes(value + entry.offset, entry.size, h);
+    } else {
+        static_assert(entry.hash != nullptr, "field is neither reflectable nor hashable");
+        return mix(h ^ entry.hash(value + entry.offset));
+    }
+}
+
+template <typename T, size_t I> void copyAt(unsigned char *destination, const unsigned char *source) {
+    constexpr FieldLayout entry = FlatLayout<T>::merged.fields[I];
+    if constexpr (entry.kind == FieldKind::Bytes) {
+        std::memcpy(destination + entry.offset, source + entry.offset, entry.size);
+    } else {
+        static_assert(entry.copy != nullptr, "field is neither reflectable nor copy assignable");
+        entry.copy(destination + entry.offset, source + entry.offset);
+    }
+}
+
+template <typename T, size_t... I> bool equalImpl(const T &a, const T &b, std::index_sequence<I...>) {
+    const unsigned char *pa = reinterpret_cast<const unsigned char *>(&a);
+    const unsigned char *pb = reinterpret_cast<const unsigned char *>(&b);
+    return (equalAt<T, I>(pa, pb) && ...);
+}
+
+template <typename T, size_t... I> size_t hashImpl(const T &value, std::index_sequence<I...>) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(&value);
+    uint64_t h = 0;
+    ((h = hashAt<T, I>(p, h)), ...);
+    return h;
+}
+
+template <typename T, size_t... I> void copyImpl(T &destination, const T &source, std::index_sequence<I...>) {
+    unsigned char *pd = reinterpret_cast<unsigned char *>(&destination);
+    const unsigned char *ps = reinterpret_cast<const unsigned char *>(&source);
+    (copyAt<T, I>(pd, ps), ...);
+}
+
+} // namespace detail
+
+// layout entry of a field of type F at offset
+// const fields are never copied, they are compared and hashed like their non const type
+template <typename F> constexpr FieldLayout field(size_t offset) {
+    using T = std::remove_cv_t<F>;
+    if constexpr (!std::is_const_v<F> && std::is_trivially_copyable_v<T> &&
+                  std::has_unique_object_representations_v<T>) {
+        return {offset, sizeof(F), FieldKind::Bytes};
+    } else {
+        FieldLayout layout{offset, sizeof(F), FieldKind::Value};
+        if constexpr (detail::isEqualityComparable<T>()) {
+            layout.equal = &detail::equalErased<T>;
+        }
+        if constexpr (detail::isHashable<T>()) {
+            layout.hash = &detail::hashErased<T>;
+        }
+        if constexpr (!std::is_const_v<F> && detail::isCopyAssignable<T>()) {
+            layout.copy = &detail::copyErased<T>;
+        }
+        return layout;
+    }
+}
+
+// compare all reflectable fields, fields marked NOT_REFLECTABLE are ignored
+template <typename T> bool equal(const T &a, const T &b) {
+    return detail::equalImpl(a, b, std::make_index_sequence<detail::FlatLayout<T>::merged.count>{});
+}
+
+// hash all reflectable fields, fields marked NOT_REFLECTABLE are ignored
+template <typename T> size_t hash(const T &value) {
+    return detail::hashImpl(value, std::make_index_sequence<detail::FlatLayout<T>::merged.count>{});
+}
+
+// copy all reflectable fields, fields marked NOT_REFLECTABLE are left untouched
+template <typename T> void copy(T &destination, const T &source) {
+    detail::copyImpl(destination, source, std::make_index_sequence<detail::FlatLayout<T>::merged.count>{});
+}
+
+// functors for use as unordered container parameters
+struct Hash {
+    template <typename T> size_t operator()(const T &value) const { return hash(value); }
+};
+
+struct Equal {
+    template <typename T> bool operator()(const T &a, const T &b) const { return equal(a, b); }
+};
+
 } // namespace Meta
 
 #define REFLECTABLE __attribute__((annotate("reflectable")))
@@ -0,0 +1,137 @@
+#include "jobserver.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+JobServer::JobServer(int jobs) : local_slots(jobs > 1 ? jobs - 1 : 0) {
+    const char *makeflags = getenv("MAKEFLAGS");
+    if (makeflags) {
+        connect(makeflags);
+    }
+}
+
+JobServer::~JobServer() {
+    // never leak tokens, the surrounding build would lose job slots
+    for (char token : tokens) {
+        while (write(write_fd, &token, 1) == -1 && (errno == EINTR || errno == EAGAIN)) {
+        }
+    }
+    if (owns_fds) {
+        close(read_fd);
+    }
+}
+
+// parse --jobserver-auth=R,W, --jobserver-auth=fifo:PATH or the older --jobserver-fds=R,W
+bool JobServer::connect(const std::string &makeflags) {
+    std::string auth;
+    for (const std::string &flag : {std::string("--jobserver-auth="), std::string("--jobserver-fds=")}) {
+        // the last occurrence wins, recursive makes append their own
+        size_t pos = makeflags.rfind(flag);
+        if (pos != std::string::npos) {
+            size_t begin = pos + flag.size();
+            auth = makeflags.substr(begin, makeflags.find(' ', begin) - begin);
+            break;
+        }
+    }
+    if (auth.empty()) {
+        return false;
+    }
+
+    if (auth.starts_with("fifo:")) {
+        // non blocking, several workers may wake up for the same token and must not get stuck in read
+        int fd = open(auth.substr(5).c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        read_fd = write_fd = fd;
+        owns_fds = true;
+        connected = true;
+        return true;
+    }
+
+    size_t comma = auth.find(',');
+    if (comma == std::string::npos) {
+        return false;
+    }
+    int r = atoi(auth.substr(0, comma).c_str());
+    int w = atoi(auth.substr(comma + 1).c_str());
+    // make only passes the pipe to recipes it knows to be recursive, the fds may be closed
+    if (r < 0 || w < 0 || fcntl(r, F_GETFD) == -1 || fcntl(w, F_GETFD) == -1) {
+        return false;
+    }
+    // reopen the read end as a separate non blocking file description, the inherited one is shared with make
+    // and may be blocking, several workers may wake up for the same token and must not get stuck in read
+    int private_r = open(("/proc/self/fd/" + std::to_string(r)).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (private_r != -1) {
+        r = private_r;
+        owns_fds = true;
+    }
+    read_fd = r;
+    write_fd = w;
+    connected = true;
+    return true;
+}
+
+// try to read a token, -1 if none arrived within the timeout
+int JobServer::readToken(int timeout_ms) {
+    // the pipe may be non blocking, wait for it to become readable
+    pollfd fd{read_fd, POLLIN, 0};
+    if (poll(&fd, 1, timeout_ms) <= 0) {
+        return -1;
+    }
+    char token;
+    ssize_t result = read(read_fd, &token, 1);
+    if (result == 1) {
+        return (unsigned char)token;
+    }
+    if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        // the jobserver went away, only the implicit token is left
+        std::lock_guard lock(mutex);
+        connected = false;
+    }
+    return -1;
+}
+
+void JobServer::acquire() {
+    std::unique_lock lock(mutex);
+    while (connected) {
+        if (implicit_token_free) {
+            implicit_token_free = false;
+            return;
+        }
+        lock.unlock();
+        // poll in short intervals, the implicit token may be released in the meantime (e.g. make -j1 has no tokens)
+        int token = readToken(50);
+        lock.lock();
+        if (token != -1) {
+            tokens.push_back((char)token);
+            return;
+        }
+    }
+    released.wait(lock, [this] { return implicit_token_free || local_slots > 0; });
+    if (implicit_token_free) {
+        implicit_token_free = false;
+    } else {
+        local_slots--;
+    }
+}
+
+void JobServer::release() {
+    std::lock_guard lock(mutex);
+    if (!tokens.empty()) {
+        // give tokens back to the surrounding build first
+        char token = tokens.back();
+        tokens.pop_back();
+        while (write(write_fd, &token, 1) == -1 && (errno == EINTR || errno == EAGAIN)) {
+        }
+        return;
+    }
+    if (implicit_token_free) {
+        local_slots++;
+    } else {
+        implicit_token_free = true;
+    }
+    released.notify_one();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// client for the GNU make jobserver, limits the number of concurrently running clang processes
+// to the job count of the surrounding build. Without a jobserver a local limit is used instead
+class JobServer {
+    int read_fd = -1;
+    int write_fd = -1;
+    bool owns_fds = false;
+    bool connected = false;
+
+    std::mutex mutex;
+    std::condition_variable released;
+    // every jobserver client owns one implicit token that is never read from the jobserver
+    bool implicit_token_free = true;
+    // tokens read from the jobserver, written back on release
+    std::vector<char> tokens;
+    // free slots besides the implicit token when there is no jobserver
+    int local_slots;
+
+    bool connect(const std::string &makeflags);
+    int readToken(int timeout_ms);
+
+  public:
+    explicit JobServer(int jobs);
+    ~JobServer();
+
+    JobServer(const JobServer &) = delete;
+    JobServer &operator=(const JobServer &) = delete;
+
+    bool isConnected() const { return connected; }
+
+    // blocks until a job may be started
+    void acquire();
+    void release();
+};
+
+// holds a job slot for its lifetime
+class JobToken {
+    JobServer &job_server;
+
+  public:
+    explicit JobToken(JobServer &job_server) : job_server(job_server) { job_server.acquire(); }
+    ~JobToken() { job_server.release(); }
+
+    JobToken(const JobToken &) = delete;
+    JobToken &operator=(const JobToken &) = delete;
+};
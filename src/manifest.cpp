@@ -0,0 +1,70 @@
+#include "manifest.hpp"
+#include <fcntl.h>
+#include <nlohmann/json.hpp>
+#include <sys/file.h>
+#include <unistd.h>
+
+#define MANIFEST_VERSION 1
+
+Manifest::Manifest(const std::string &path) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return;
+    }
+    // flock locks belong to the open file description, workers of the same process exclude each other too
+    if (flock(fd, LOCK_EX) == -1) {
+        close(fd);
+        fd = -1;
+        return;
+    }
+
+    std::string content;
+    char buffer[0x10000];
+    ssize_t size;
+    while ((size = read(fd, buffer, sizeof(buffer))) > 0) {
+        content.append(buffer, size);
+    }
+
+    // an empty, broken or outdated manifest is simply rebuilt
+    nlohmann::json json = nlohmann::json::parse(content, nullptr, false);
+    if (json.is_discarded() || !json.is_object() || json.value("version", 0) != MANIFEST_VERSION ||
+        !json.contains("types")) {
+        return;
+    }
+    for (const auto &[name, type] : json["types"].items()) {
+        types[name] = {type.value("header", ""), type.value("signature", ""), type.value("output", "")};
+    }
+}
+
+Manifest::~Manifest() {
+    if (fd != -1) {
+        // closing releases the lock
+        close(fd);
+    }
+}
+
+void Manifest::save() {
+    if (fd == -1) {
+        return;
+    }
+    nlohmann::json json;
+    json["version"] = MANIFEST_VERSION;
+    json["types"] = nlohmann::json::object();
+    for (const auto &[name, type] : types) {
+        json["types"][name] = {{"header", type.header}, {"signature", type.signature}, {"output", type.output}};
+    }
+    std::string content = json.dump(4) + "\n";
+
+    // rewrite in place, replacing the file would drop the lock other processes wait on
+    if (ftruncate(fd, 0) == -1) {
+        return;
+    }
+    size_t written = 0;
+    while (written < content.size()) {
+        ssize_t result = pwrite(fd, content.data() + written, content.size() - written, written);
+        if (result <= 0) {
+            return;
+        }
+        written += result;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+struct ManifestEntry {
+    // header the type is defined in
+    std::string header;
+    // hash of the fields of the type, changes whenever the generated metadata would
+    std::string signature;
+    // meta header the specialization of the type is generated into
+    std::string output;
+};
+
+// project wide record of all reflectable types, stored as json
+// the file stays locked while the object lives, so parallel runs and workers write their outputs one after another
+class Manifest {
+    int fd = -1;
+
+  public:
+    // qualified name -> entry
+    std::map<std::string, ManifestEntry> types;
+
+    // blocks until no other process or worker holds the manifest
+    explicit Manifest(const std::string &path);
+    ~Manifest();
+
+    Manifest(const Manifest &) = delete;
+    Manifest &operator=(const Manifest &) = delete;
+
+    bool isOpen() const { return fd != -1; }
+
+    void save();
+};
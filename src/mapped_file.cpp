@@ -0,0 +1,66 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ViewStreamBuf::ViewStreamBuf(std::string_view view) {
+    // the get area is never written to, casting away const is safe
+    char *begin = const_cast<char *>(view.data());
+    setg(begin, begin, begin + view.size());
+}
+
+ViewStreamBuf::pos_type ViewStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir,
+                                               std::ios_base::openmode which) {
+    if (!(which & std::ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+    off_type base = 0;
+    if (dir == std::ios_base::cur) {
+        base = gptr() - eback();
+    } else if (dir == std::ios_base::end) {
+        base = egptr() - eback();
+    }
+    return seekpos(pos_type(base + off), which);
+}
+
+ViewStreamBuf::pos_type ViewStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which) {
+    off_type offset = pos;
+    if (!(which & std::ios_base::in) || offset < 0 || offset > egptr() - eback()) {
+        return pos_type(off_type(-1));
+    }
+    setg(eback(), eback() + offset, egptr());
+    return pos;
+}
+
+MappedFile::MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        size = st.st_size;
+        if (size == 0) {
+            // mmap does not accept empty mappings, an empty view is still valid
+            open = true;
+        } else {
+            data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                data = nullptr;
+                size = 0;
+            } else {
+                // the parser reads the AST front to back
+                madvise(data, size, MADV_SEQUENTIAL);
+                open = true;
+            }
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data) {
+        munmap(data, size);
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+// seekable read-only stream buffer over a contiguous block of memory, the memory is not owned
+class ViewStreamBuf : public std::streambuf {
+  public:
+    explicit ViewStreamBuf(std::string_view view);
+
+  protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
+
+// read-only memory mapping of a whole file
+class MappedFile {
+    void *data = nullptr;
+    size_t size = 0;
+    bool open = false;
+
+  public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const { return open; }
+    std::string_view view() const { return {static_cast<const char *>(data), size}; }
+};
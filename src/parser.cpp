@@ -1,4 +1,8 @@
 #include "parser.hpp"
+#include "jobserver.hpp"
+#include "manifest.hpp"
+#include "mapped_file.hpp"
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <cstdio>
@@ -8,6 +12,8 @@
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <unistd.h>
 
 #define VERSION "Rice metacompiler v0.1.0"
 
@@ -25,6 +31,30 @@ std::vector<std::string> split(const std::string &target, char c) {
     return result;
 }
 
+// escape spaces in make rule paths
+std::string escapeMakePath(const std::string &path) {
+    std::string escaped;
+    for (char ch : path) {
+        if (ch == ' ' || ch == '#') {
+            escaped += '\\';
+        }
+        escaped += ch;
+    }
+    return escaped;
+}
+
+// FNV-1a of str as hex, stable across runs
+std::string hashString(const std::string &str) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char ch : str) {
+        hash ^= ch;
+        hash *= 0x100000001b3ULL;
+    }
+    std::stringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return hex.str();
+}
+
 int parsePositiveInt(const std::string &s) {
     try {
         std::size_t pos;
@@ -34,6 +64,8 @@ int parsePositiveInt(const std::string &s) {
         return result;
     } catch (const std::invalid_argument e) {
         return -1;
+    } catch (const std::out_of_range &) {
+        return -1;
     }
 }
 
@@ -82,8 +114,25 @@ std::string Struct::getName() const {
         for (int i = 1; i < template_params.size(); i++) {
             full_name += ", " + template_params.at(i).name;
         }
+        full_name += ">";
     }
-    return full_name + ">";
+    return full_name;
+}
+
+std::string Struct::getQualifiedName() const {
+    std::string qualified_name;
+    for (auto &location_node : location) {
+        qualified_name += location_node.name + "::";
+    }
+    return qualified_name + name;
+}
+
+std::string Struct::getShardName() const {
+    std::string shard_name;
+    for (auto &location_node : location) {
+        shard_name += location_node.name + "__";
+    }
+    return shard_name + name;
 }
 
 bool Struct::isNestedInTemplates() const {
@@ -95,23 +144,131 @@ bool Struct::isNestedInTemplates() const {
     return false;
 }
 
+// AST node kinds the parser looks at, everything else can be dropped from a compact dump
+constexpr std::string_view used_node_kinds[] = {"CXXRecordDecl", "FieldDecl",         "AnnotateAttr",
+                                                "NamespaceDecl", "ClassTemplateDecl", "TemplateTypeParmDecl"};
+
+// last file mentioned in the source locations of an AST line, empty if there is none
+// clang only prints the file when it changes, following locations are 'line:' and 'col:' relative to it
+std::string_view lastFileInLine(std::string_view line) {
+    std::string_view file;
+    size_t pos = 0;
+    while ((pos = line.find(':', pos)) != std::string_view::npos) {
+        // file locations look like <path>:<line>:<col>
+        size_t line_end = pos + 1;
+        while (line_end < line.size() && isdigit(line[line_end])) {
+            line_end++;
+        }
+        if (line_end == pos + 1 || line_end + 1 >= line.size() || line[line_end] != ':' ||
+            !isdigit(line[line_end + 1])) {
+            pos++;
+            continue;
+        }
+        size_t begin = line.find_last_of(" <=", pos);
+        std::string_view candidate = line.substr(begin + 1, pos - begin - 1);
+        // skip relative locations and <built-in>, <scratch space>
+        if (!candidate.empty() && candidate != "line" && candidate != "col" && !candidate.ends_with('>')) {
+            file = candidate;
+        }
+        pos = line_end;
+    }
+    return file;
+}
+
+// strip all lines with node kinds unused by the parser, tree prefixes are kept so line levels stay the same
+// lines switching to another file are kept as well, the file of each struct can still be tracked
+std::string compactAst(std::string_view ast) {
+    std::string compact;
+    size_t line_begin = 0;
+    bool first_line = true;
+    while (line_begin < ast.size()) {
+        size_t line_end = ast.find('\n', line_begin);
+        line_end = line_end == std::string_view::npos ? ast.size() : line_end + 1;
+        std::string_view line = ast.substr(line_begin, line_end - line_begin);
+        line_begin = line_end;
+
+        // the parser always skips the first line (TranslationUnitDecl)
+        if (first_line) {
+            compact += line;
+            first_line = false;
+            continue;
+        }
+
+        size_t kind_begin = line.find_first_not_of("|`- ");
+        if (kind_begin == std::string_view::npos) {
+            continue;
+        }
+        std::string_view kind = line.substr(kind_begin);
+        if (!lastFileInLine(line).empty()) {
+            compact += line;
+            continue;
+        }
+        for (auto &used_kind : used_node_kinds) {
+            if (kind.starts_with(used_kind) && kind.size() > used_kind.size() && kind[used_kind.size()] == ' ') {
+                compact += line;
+                break;
+            }
+        }
+    }
+    return compact;
+}
+
+// how the metadata of a struct is provided to shards referencing it
+struct StructOutput {
+    // shard of the struct if it is generated into another directory
+    std::string include;
+    // the shard of the struct is up to date and does not need to be generated
+    bool unchanged = false;
+};
+
+using StructOutputs = std::unordered_map<const Struct *, StructOutput>;
+
+// file written by generateMetaShards, code is empty if the shard is unchanged
+struct MetaShard {
+    std::string file;
+    std::string code;
+    bool unchanged;
+};
+
 class Parser {
     Location current_location;
     std::vector<std::unique_ptr<Struct>> current_struct_tree;
     TemplateDeclarationHierarchy current_template_declaration_hierarchy;
     std::vector<std::unique_ptr<Struct>> all_structs;
-    std::stringstream &ss;
+    std::istream &ss;
+    // warnings are collected with the rest of the output of the run, headers are processed in parallel
+    std::ostream &log;
     int currentLevel = 0;
+    bool track_files;
+    std::string current_file;
 
   public:
-    explicit Parser(std::stringstream &ss) : ss(ss) { skipUntil('\n'); }
+    Parser(std::istream &ss, std::ostream &log, bool track_files = false)
+        : ss(ss), log(log), track_files(track_files) {
+        skipUntil('\n');
+    }
+
+    const std::vector<std::unique_ptr<Struct>> &getStructs() const { return all_structs; }
+
+    // follow the file the AST is currently in
+    void updateCurrentFile() {
+        auto pos = ss.tellg();
+        std::string line;
+        std::getline(ss, line);
+        ss.clear();
+        ss.seekg(pos);
+        std::string_view file = lastFileInLine(line);
+        if (!file.empty()) {
+            current_file = file;
+        }
+    }
 
     // get line level in the AST
     int getLineLevel() {
         using namespace std;
         int lvl = 0;
         int ch;
-        stringstream::pos_type pos;
+        istream::pos_type pos;
         while (true) {
             pos = ss.tellg();
             ch = ss.get();
@@ -121,16 +278,18 @@ class Parser {
             }
             break;
         }
+        ss.clear();
         ss.seekg(pos);
         return lvl / 2 + 1;
     }
 
     void skipAllChars(char ch) {
         // skip all 'ch' characters
-        std::stringstream::pos_type pos;
+        std::istream::pos_type pos;
         do {
             pos = ss.tellg();
         } while (ss.get() == ch);
+        ss.clear();
         ss.seekg(pos);
     }
 
@@ -152,7 +311,7 @@ class Parser {
         bool under_triangle_parenthesis = false;
 
         std::string args_raw;
-        while (ss.peek() != '\n') {
+        while (ss.peek() != '\n' && ss.peek() != EOF) {
             current_char = ss.get();
 
             if (current_char == '\'') {
@@ -181,6 +340,8 @@ class Parser {
         auto pos = ss.tellg();
         for (char ch : str) {
             if (ch != ss.get()) {
+                // reading past the end of the last line sets failbit, seekg would be ignored
+                ss.clear();
                 ss.seekg(pos);
                 return false;
             }
@@ -206,7 +367,8 @@ class Parser {
                 continue;
             }
             str_pos = str.begin();
-        } while (ch != end);
+        } while (ch != end && ch != EOF);
+        ss.clear();
         ss.seekg(pos);
         return false;
     }
@@ -235,6 +397,7 @@ class Parser {
                     if (args.back() != "struct" && args.back() != "class") {
                         uptr<Struct> str;
                         Struct *raw_struct = new Struct{current_location, args.back(), {}, templateDeclaration};
+                        raw_struct->source_file = current_file;
                         str.reset(raw_struct);
                         current_struct_tree.push_back(std::move(str));
                         location = {args.back(), LocationNodeType::STRUCT, raw_struct};
@@ -250,14 +413,24 @@ class Parser {
                 if (args.back() == "mutable") {
                     args.pop_back();
                 }
+                // the type is printed as 'type' or 'type':'desugared type'
                 std::string type = args.back();
                 type.erase(0, 1);
+                std::string canonical_type;
                 size_t pos = type.find_first_of('\'');
                 if (pos != std::string::npos) {
+                    if (type.compare(pos, 3, "':'") == 0) {
+                        canonical_type = type.substr(pos + 3);
+                        canonical_type = canonical_type.substr(0, canonical_type.find_first_of('\''));
+                    }
                     type = type.substr(0, pos);
                 }
+                if (canonical_type.empty()) {
+                    canonical_type = type;
+                }
                 // add to last struct
                 current_struct_tree.back()->fields.push_back({args.at(args.size() - 2), type});
+                current_struct_tree.back()->fields.back().canonical_type = canonical_type;
             }
             // parse annotations
         } else if (startsWith("AnnotateAttr")) {
@@ -317,6 +490,9 @@ class Parser {
         do {
             // get line beginning
             auto line_begin = ss.tellg();
+            if (track_files) {
+                updateCurrentFile();
+            }
             // get current level
             currentLevel = getLineLevel();
 
@@ -365,50 +541,202 @@ class Parser {
         } while (ss.peek() != -1);
     }
 
-    void dump() const {
+    void dump(std::ostream &os) const {
         for (auto &s : all_structs) {
-            std::cout << *s << "\n\n";
+            os << *s << "\n\n";
         }
     }
 
-    // generate code for reflectionHelper from the parsed structs
-    std::string generateMetaCode(const std::string &header_file) const {
-        std::stringstream generated_code;
-        std::string type_string;
-        std::string field_string;
-        std::string full_name;
+    // find the reflectable struct a field holds by value, matched exactly by its fully qualified (desugared) type
+    // pointers, references, arrays and ambiguous names are not followed
+    const Struct *findFieldStruct(const Field &field) const {
+        std::string type = field.canonical_type;
+        if (type.starts_with("struct ")) {
+            type.erase(0, 7);
+        } else if (type.starts_with("class ")) {
+            type.erase(0, 6);
+        }
+        // template ids are matched by the template name, anything after the arguments (e.g. '*') is rejected
+        bool templated = type.ends_with('>');
+        if (templated) {
+            type = type.substr(0, type.find('<'));
+        }
+        if (type.empty() || type.find_first_of("*&[]()<> ") != std::string::npos) {
+            return nullptr;
+        }
+        const Struct *match = nullptr;
+        for (auto &str : all_structs) {
+            if (str->template_params.empty() == templated || str->isNestedInTemplates() ||
+                str->getQualifiedName() != type) {
+                continue;
+            }
+            if (match) {
+                return nullptr;
+            }
+            match = str.get();
+        }
+        return match;
+    }
+
+    // find a non templated reflectable struct held by value in a field, its fields can be flattened
+    const Struct *findReflectable(const Field &field) const {
+        const Struct *str = findFieldStruct(field);
+        return str && str->template_params.empty() ? str : nullptr;
+    }
+
+    // collect layout entries of all reflectable fields, nested reflectable structs are flattened into the table
+    void flattenLayout(const Struct &str, const std::string &owner, const std::string &offset_prefix,
+                       std::vector<std::string> &entries) const {
+        for (auto &field : str.fields) {
+            if (field.not_reflectable) {
+                continue;
+            }
+            std::string offset = offset_prefix + "offsetof(" + owner + ", " + field.name + ")";
+            const Struct *nested = findReflectable(field);
+            if (nested && nested != &str) {
+                flattenLayout(*nested, nested->getLocation(true), offset + " + ", entries);
+            } else {
+                entries.push_back("Meta::field<" + field.type + ">(" + offset + ")");
+            }
+        }
+    }
+
+    // find reflectable structs (templated ones included) held by value in the fields of str
+    // their metadata has to be known before the one of str, pointers and references are not followed
+    std::vector<const Struct *> findReferencedStructs(const Struct &str) const {
+        std::vector<const Struct *> referenced;
+        for (auto &field : str.fields) {
+            if (field.not_reflectable) {
+                continue;
+            }
+            const Struct *other = findFieldStruct(field);
+            if (other && other != &str && std::find(referenced.begin(), referenced.end(), other) == referenced.end()) {
+                referenced.push_back(other);
+            }
+        }
+        return referenced;
+    }
+
+    // stable hash of everything the generated metadata of a struct depends on, including the reflectable structs
+    // held by value, every struct is hashed once by its own fields so recursive types terminate
+    std::string getSignature(const Struct &str) const {
+        std::string signature = VERSION;
+        std::vector<const Struct *> pending{&str};
+        std::set<const Struct *> visited{&str};
+        while (!pending.empty()) {
+            const Struct *current = pending.back();
+            pending.pop_back();
+            // the shared meta header a referenced struct is included from depends on its header
+            signature += "|" + current->getTemplateHeading() + current->getLocation(true) + " " + current->source_file;
+            for (auto &field : current->fields) {
+                signature += "|" + field.type + " " + field.name + " " + field.getAttributes() +
+                             (field.not_reflectable ? " not_reflectable" : "");
+            }
+            for (const Struct *referenced : findReferencedStructs(*current)) {
+                if (visited.insert(referenced).second) {
+                    pending.push_back(referenced);
+                }
+            }
+        }
+        return hashString(signature);
+    }
 
+    // includes and pragmas every generated meta header starts with
+    static std::string generateMetaHeading(const std::string &header_file) {
+        std::stringstream generated_code;
         generated_code << "#pragma once\n\n";
         generated_code << "#include \"" << header_file << "\"\n";
         generated_code << "#include <MetaCompiler/ReflectionHelper.hpp>\n\n";
+        // offsetof is used on non standard layout types in the layout tables
+        generated_code << "#pragma GCC diagnostic push\n";
+        generated_code << "#pragma GCC diagnostic ignored \"-Winvalid-offsetof\"\n\n";
+        return generated_code.str();
+    }
 
-        for (auto &str : all_structs) {
+    // generate the TypeOf specialization of one struct
+    std::string generateStructMeta(const Struct &str) const {
+        std::stringstream generated_code;
+        std::string type_string;
+        std::string field_string;
+        std::string full_name;
+        std::vector<std::string> layout_entries;
+
+        if (str.isNestedInTemplates()) {
+            log << "WARNING: structs nested in templated structs are not supported(yet), affected struct: " +
+                             str.getName() + "\n";
+        }
 
-            if (str->isNestedInTemplates()) {
-                std::cout << "WARNING: structs nested in templated structs are not supported(yet), affected struct: " +
-                                 str->getName() + "\n";
+        full_name = str.getLocation(true);
+        std::string template_heading = str.getTemplateHeading();
+        generated_code << (template_heading.empty() ? "template <> " : template_heading)
+                       << "struct Meta::TypeOf<" + full_name;
+        generated_code << "> {\n";
+        type_string = "Type<" + full_name;
+        for (auto &field : str.fields) {
+            if (field.not_reflectable) {
+                continue;
             }
+            type_string += ", " + field.type;
+            field_string += ", \n    {\"" + field.name + "\", &" + full_name + "::" + field.name + ", " +
+                            field.getAttributes() + "}";
+        }
+        type_string += ">";
+        generated_code << "    " << type_string << " type() { \n    return " << type_string << "{Types::Struct,\n    "
+                       << "\"" << str.getLocation(false) << "\", "
+                       << "\"" << str.name << "\"" << field_string << "}; }\n";
+
+        flattenLayout(str, "type_t", "", layout_entries);
+        generated_code << "    using type_t = " << full_name << ";\n";
+        generated_code << "    static constexpr std::array<Meta::FieldLayout, " << layout_entries.size() << "> layout{{";
+        for (auto &entry : layout_entries) {
+            generated_code << "\n        " << entry << ",";
+        }
+        generated_code << "\n    }};\n};\n";
+        return generated_code.str();
+    }
+
+    // generate code for reflectionHelper from the given structs
+    // includes are meta headers of structs held by value that are generated elsewhere
+    std::string generateMetaCode(const std::string &header_file, const std::vector<const Struct *> &structs,
+                                 const std::vector<std::string> &includes = {}) const {
+        std::string generated_code = generateMetaHeading(header_file);
+        for (auto &include : includes) {
+            generated_code += "#include \"" + include + "\"\n";
+        }
+        if (!includes.empty()) {
+            generated_code += "\n";
+        }
+        for (const Struct *str : structs) {
+            generated_code += generateStructMeta(*str);
+        }
+        return generated_code + "\n#pragma GCC diagnostic pop\n";
+    }
 
-            field_string.clear();
-            full_name = str->getLocation(true);
-            generated_code << str->getTemplateHeading() << " struct Meta::TypeOf<" + full_name;
-            generated_code << "> {\n";
-            type_string = "Type<" + full_name;
-            for (auto &field : str->fields) {
-                if (field.not_reflectable) {
-                    continue;
+    // generate one meta header per given struct
+    // shards include the shards of reflectable structs held by value, so they can be included on their own
+    std::vector<MetaShard> generateMetaShards(const std::string &header_file,
+                                              const std::vector<const Struct *> &structs,
+                                              const StructOutputs &outputs = {}) const {
+        std::vector<MetaShard> shards;
+        for (const Struct *str : structs) {
+            auto output = outputs.find(str);
+            if (output != outputs.end() && output->second.unchanged) {
+                shards.push_back({str->getShardName() + ".hpp", "", true});
+                continue;
+            }
+            std::string generated_code = generateMetaHeading(header_file);
+            for (const Struct *referenced : findReferencedStructs(*str)) {
+                auto referenced_output = outputs.find(referenced);
+                if (referenced_output != outputs.end() && !referenced_output->second.include.empty()) {
+                    generated_code += "#include \"" + referenced_output->second.include + "\"\n";
+                } else {
+                    generated_code += "#include \"" + referenced->getShardName() + ".hpp\"\n";
                 }
-                type_string += ", " + field.type;
-                field_string += ", \n    {\"" + field.name + "\", &" + full_name + "::" + field.name + ", " +
-                                field.getAttributes() + "}";
             }
-            type_string += ">";
-            generated_code << "    " << type_string << " type() { \n    return " << type_string
-                           << "{Types::Struct,\n    "
-                           << "\"" << str->getLocation(false) << "\", "
-                           << "\"" << str->name << "\"" << field_string << "}; }\n};\n";
+            generated_code += generateStructMeta(*str) + "\n#pragma GCC diagnostic pop\n";
+            shards.push_back({str->getShardName() + ".hpp", std::move(generated_code), false});
         }
-        return generated_code.str();
+        return shards;
     }
 };
 
@@ -426,6 +754,329 @@ std::string exec(const std::string_view &cmd) {
     return result;
 }
 
+// write content to path, keeps the file (and its timestamp) untouched if the content is the same
+// returns true if the file was written
+bool writeIfChanged(const std::filesystem::path &path, const std::string &content) {
+    if (std::filesystem::exists(path) && std::filesystem::file_size(path) == content.size()) {
+        MappedFile existing(path.string());
+        if (existing.isOpen() && existing.view() == content) {
+            return false;
+        }
+    }
+    // replace the file at once, compilers or other runs reading it never see it half written
+    std::filesystem::path temp = path;
+    temp += ".tmp" + std::to_string(getpid()) + "_" +
+            std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    std::ofstream file(temp, std::ios::binary);
+    file << content;
+    file.close();
+    std::filesystem::rename(temp, path);
+    return true;
+}
+
+struct RunOptions {
+    std::string additional_params;
+    std::string ast_file;
+    std::string dep_file;
+    bool print_to_console = false;
+    bool dump_ast = false;
+    bool compact_dump = false;
+    bool shard = false;
+    std::string manifest_file;
+};
+
+std::mutex output_mutex;
+
+// shared meta header of the types defined in header, without extension (the shard directory with --shard)
+// it only depends on the defining header, so every run generating the type writes it to the same place
+std::filesystem::path sharedMetaPath(const std::string &manifestFile, const std::string &header) {
+    std::filesystem::path manifestPath(manifestFile);
+    return (manifestPath.parent_path() / (manifestPath.stem().string() + "_meta") /
+            (std::filesystem::path(header).stem().string() + "_" + hashString(header).substr(0, 8) + "_meta"))
+        .lexically_normal();
+}
+
+// generate every parsed type into the shared meta header of the header defining it, the meta header of this run only
+// includes the shared ones, the manifest must stay locked until all of them are written
+void writeSharedMeta(const Parser &parser, const std::string &headerFile, const RunOptions &options,
+                     Manifest &manifest, std::ostream &log) {
+    using namespace std;
+
+    string headerFileName = filesystem::path(headerFile).stem().string();
+    // group the structs by the header defining them
+    map<string, vector<const Struct *>> groups;
+    unordered_map<const Struct *, filesystem::path> sharedPaths;
+    for (auto &str : parser.getStructs()) {
+        // types are attributed to the header being processed if the AST has no file for them
+        string header = str->source_file.empty() ? headerFile : str->source_file;
+        header = filesystem::absolute(header).lexically_normal().string();
+        groups[header].push_back(str.get());
+        sharedPaths[str.get()] = sharedMetaPath(options.manifest_file, header);
+    }
+    auto sharedOutput = [&](const Struct *str) {
+        return options.shard ? (sharedPaths[str] / (str->getShardName() + ".hpp")).string()
+                             : sharedPaths[str].string() + ".hpp";
+    };
+
+    string umbrella = "#pragma once\n\n";
+    set<string> ownShards;
+    if (options.shard) {
+        filesystem::create_directories(headerFileName + "_meta");
+    }
+    int written = 0;
+    int total = 0;
+    for (auto &[header, structs] : groups) {
+        filesystem::path sharedPath = sharedMetaPath(options.manifest_file, header);
+        filesystem::create_directories(options.shard ? sharedPath : sharedPath.parent_path());
+
+        // record the types, unchanged ones whose output exists are not generated again
+        StructOutputs outputs;
+        set<string> names;
+        bool unchanged = true;
+        for (const Struct *str : structs) {
+            string name = str->getQualifiedName();
+            string signature = parser.getSignature(*str);
+            string output = sharedOutput(str);
+            auto type = manifest.types.find(name);
+            outputs[str].unchanged = type != manifest.types.end() && type->second.output == output &&
+                                     type->second.signature == signature && filesystem::exists(output);
+            unchanged &= outputs[str].unchanged;
+            names.insert(name);
+            manifest.types[name] = {header, signature, output};
+        }
+        // types removed from the header
+        for (auto type = manifest.types.begin(); type != manifest.types.end();) {
+            if (type->second.header == header && !names.contains(type->first)) {
+                type = manifest.types.erase(type);
+                unchanged = false;
+            } else {
+                type++;
+            }
+        }
+
+        // structs held by value from other headers are included from their shared meta header
+        vector<string> includes;
+        for (const Struct *str : structs) {
+            for (const Struct *referenced : parser.findReferencedStructs(*str)) {
+                string include = sharedOutput(referenced);
+                if (sharedPaths[referenced] != sharedPath) {
+                    outputs[referenced].include = include;
+                    if (find(includes.begin(), includes.end(), include) == includes.end()) {
+                        includes.push_back(include);
+                    }
+                }
+            }
+        }
+
+        if (!options.shard) {
+            total++;
+            if (!unchanged) {
+                written +=
+                    writeIfChanged(sharedPath.string() + ".hpp", parser.generateMetaCode(header, structs, includes));
+            }
+            umbrella += "#include \"" + sharedPath.string() + ".hpp\"\n";
+            continue;
+        }
+
+        set<string> shardFiles;
+        for (auto &shard : parser.generateMetaShards(header, structs, outputs)) {
+            if (!shard.unchanged) {
+                written += writeIfChanged(sharedPath / shard.file, shard.code);
+            }
+            shardFiles.insert(shard.file);
+            total++;
+            umbrella += "#include \"" + (sharedPath / shard.file).string() + "\"\n";
+            // the shards of this run forward to the shared ones, so they can still be included on their own
+            ownShards.insert(shard.file);
+            writeIfChanged(filesystem::path(headerFileName + "_meta") / shard.file,
+                           "#pragma once\n\n#include \"" + (sharedPath / shard.file).string() + "\"\n");
+        }
+        // remove shards of structs that no longer exist in the header
+        for (auto &entry : filesystem::directory_iterator(sharedPath)) {
+            if (entry.path().extension() == ".hpp" && !shardFiles.contains(entry.path().filename().string())) {
+                filesystem::remove(entry.path());
+            }
+        }
+    }
+
+    // the header of this run may no longer define any reflectable type, drop the types and outputs it had
+    string ownHeader = filesystem::absolute(headerFile).lexically_normal().string();
+    if (!groups.contains(ownHeader)) {
+        for (auto type = manifest.types.begin(); type != manifest.types.end();) {
+            if (type->second.header == ownHeader) {
+                filesystem::remove(type->second.output);
+                type = manifest.types.erase(type);
+            } else {
+                type++;
+            }
+        }
+        filesystem::path sharedPath = sharedMetaPath(options.manifest_file, ownHeader);
+        if (filesystem::is_directory(sharedPath) && filesystem::is_empty(sharedPath)) {
+            filesystem::remove(sharedPath);
+        }
+    }
+
+    if (options.shard) {
+        for (auto &entry : filesystem::directory_iterator(headerFileName + "_meta")) {
+            if (entry.path().extension() == ".hpp" && !ownShards.contains(entry.path().filename().string())) {
+                filesystem::remove(entry.path());
+            }
+        }
+    }
+    log << "Updated " << written << " of " << total
+        << (options.shard ? " shared meta shards\n" : " shared meta headers\n");
+
+    ofstream meta(headerFileName + "_meta.hpp");
+    meta << umbrella;
+    meta.close();
+}
+
+// build the AST for one header and generate its meta header, returns false on failure
+bool generateForHeader(const std::string &headerFile, const RunOptions &options, JobServer &job_server) {
+    using namespace std;
+
+    // collect the output, headers are processed in parallel
+    stringstream log;
+    string headerFileName = filesystem::path(headerFile).stem().string();
+    string metaFile = headerFileName + "_meta.hpp";
+    string additional_params = options.additional_params;
+    bool dump_ast = options.dump_ast;
+
+    // hold a job slot for the whole header, parsing and generating large ASTs loads the host as much as clang
+    JobToken token(job_server);
+
+    log << "\nRunning on " << filesystem::absolute(headerFile) << "\n\n";
+
+    if (options.dep_file.length()) {
+        // let clang track the includes, the rule target is the generated meta header
+        additional_params +=
+            " -MD -MF '" + options.dep_file + "' -MT '" + filesystem::absolute(metaFile).string() + "'";
+    }
+
+    string ast;
+    uptr<MappedFile> mapped_ast;
+    string_view ast_view;
+
+    auto start_clang = chrono::steady_clock::now();
+    if (options.ast_file.length()) {
+        log << "Replaying AST from " << filesystem::absolute(options.ast_file) << "\n";
+        mapped_ast = make_unique<MappedFile>(options.ast_file);
+        if (!mapped_ast->isOpen()) {
+            lock_guard lock(output_mutex);
+            cout << log.str() << "\n\nCould not open " << options.ast_file << "\n";
+            return false;
+        }
+        ast_view = mapped_ast->view();
+
+        if (options.dep_file.length()) {
+            // the includes are unknown without clang, only the replayed AST itself is a dependency
+            ofstream dep(options.dep_file);
+            dep << escapeMakePath(filesystem::absolute(metaFile).string()) << ": "
+                << escapeMakePath(filesystem::absolute(options.ast_file).string()) << "\n";
+            dep.close();
+        }
+    } else {
+        start_clang = chrono::steady_clock::now();
+        ast = exec("clang++" + additional_params +
+                   " -Xclang -ast-dump -fsyntax-only -fno-color-diagnostics -Wno-visibility -std=c++17 '" + headerFile +
+                   "'");
+        ast_view = ast;
+    }
+    auto end_clang = chrono::steady_clock::now();
+
+    // dumping over the replayed file would truncate the mapping under us
+    if (dump_ast && options.ast_file.length() && filesystem::exists(headerFileName + "_ast") &&
+        filesystem::equivalent(options.ast_file, headerFileName + "_ast")) {
+        log << "WARNING: not dumping AST over the replayed file " << options.ast_file << "\n";
+        dump_ast = false;
+    }
+
+    if (dump_ast) {
+        ofstream ast_file(headerFileName + "_ast");
+        if (options.compact_dump) {
+            ast_file << compactAst(ast_view);
+        } else {
+            ast_file << ast_view;
+        }
+        ast_file.close();
+    }
+
+    auto start_parse = chrono::steady_clock::now();
+
+    ViewStreamBuf ast_buf(ast_view);
+    istream ss(&ast_buf);
+    // the manifest records the header every type comes from
+    Parser parser(ss, log, options.manifest_file.length());
+    parser.parseLevel();
+
+    if (options.print_to_console) {
+        parser.dump(log);
+    }
+
+    vector<const Struct *> structs;
+    for (auto &str : parser.getStructs()) {
+        structs.push_back(str.get());
+    }
+
+    bool shared = false;
+    if (options.manifest_file.length()) {
+        // keep the manifest locked until the shared outputs are written, parallel runs write them one after another
+        Manifest manifest(options.manifest_file);
+        if (manifest.isOpen()) {
+            writeSharedMeta(parser, headerFile, options, manifest, log);
+            manifest.save();
+            shared = true;
+        } else {
+            log << "WARNING: could not open manifest " << options.manifest_file << ", generating all types\n";
+        }
+    }
+
+    if (!shared && options.shard) {
+        // shards are only rewritten when their content changes, TUs including them are not rebuilt otherwise
+        filesystem::path shardDir = headerFileName + "_meta";
+        filesystem::create_directories(shardDir);
+        string umbrella = "#pragma once\n\n";
+        set<string> shardFiles;
+        int written = 0;
+        // shards are one directory deeper than the umbrella header
+        string shardHeaderFile = headerFile;
+        if (filesystem::path(headerFile).is_relative()) {
+            shardHeaderFile = filesystem::relative(headerFile, shardDir).string();
+        }
+        for (auto &shard : parser.generateMetaShards(shardHeaderFile, structs)) {
+            if (!shard.unchanged) {
+                written += writeIfChanged(shardDir / shard.file, shard.code);
+            }
+            shardFiles.insert(shard.file);
+            umbrella += "#include \"" + (shardDir / shard.file).string() + "\"\n";
+        }
+        // remove shards of structs that no longer exist
+        for (auto &entry : filesystem::directory_iterator(shardDir)) {
+            if (entry.path().extension() == ".hpp" && !shardFiles.contains(entry.path().filename().string())) {
+                filesystem::remove(entry.path());
+            }
+        }
+        log << "Updated " << written << " of " << shardFiles.size() << " meta shards\n";
+
+        ofstream meta(metaFile);
+        meta << umbrella;
+        meta.close();
+    } else if (!shared) {
+        ofstream meta(metaFile);
+        meta << parser.generateMetaCode(headerFile, structs);
+        meta.close();
+    }
+
+    log << "\nBuilt in: "
+        << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_parse).count() << "ms + "
+        << chrono::duration_cast<chrono::milliseconds>(end_clang - start_clang).count()
+        << (options.ast_file.length() ? "ms ast loading\n" : "ms clang ast generation\n");
+
+    lock_guard lock(output_mutex);
+    cout << log.str();
+    return true;
+}
+
 int main(int argc, char *argv[]) {
     using json = nlohmann::json;
     using namespace std;
@@ -435,13 +1086,12 @@ int main(int argc, char *argv[]) {
     string sourceFile;
     string sourceFileAbsPath;
 
-    string headerFile;
-    string headerFileName;
+    vector<string> headerFiles;
 
     string curr_arg;
 
-    bool print_to_console = false;
-    bool dump_ast = false;
+    RunOptions options;
+    int jobs = max(1, (int)thread::hardware_concurrency());
 
     for (int i = 0; i < argc; i++) {
         curr_arg = std::string(argv[i]);
@@ -456,47 +1106,82 @@ int main(int argc, char *argv[]) {
             cout << "  --version                 Print version string\n";
             cout << "  --print                   Print generated code to stdout\n";
             cout << "  --dump                    Dump generated AST to a file\n";
-            cout << "  header_file_path=[path]   Path to the header file to build the AST for\n";
+            cout << "  --compact                 Only keep node kinds used by the parser in the dumped AST\n";
+            cout << "  --shard                   Write one meta header per struct into <name>_meta/, <name>_meta.hpp "
+                    "includes all of them\n";
+            cout << "  header_file_path=[path]   Path to the header file to build the AST for, can be repeated\n";
             cout << "  source_file_path=[path]   Path to the source file, used with 'compile_commands_path' to "
                     "search for additional includes and parameters\n";
             cout << "  compile_commands_path=    Path to compile_commands.json\n";
+            cout << "  ast_file_path=[path]      Path to a previously dumped AST, used instead of running clang\n";
+            cout << "  depfile_path=[path]       Write a make style depfile listing every header the AST depends on\n";
+            cout << "  manifest_path=[path]      Project wide type manifest, every type is only generated once across "
+                    "all headers sharing it\n";
+            cout << "  jobs=[n]                  Maximum number of headers processed concurrently when not running "
+                    "under a make jobserver\n";
             exit(0);
         } else if (curr_arg.starts_with("header_file_path=")) {
-            headerFile = curr_arg.substr(17);
-            filesystem::path headerFilePath = headerFile;
-            headerFileName = headerFilePath.stem().string();
+            headerFiles.push_back(curr_arg.substr(17));
         } else if (curr_arg.starts_with("source_file_path=")) {
             sourceFile = curr_arg.substr(17);
             filesystem::path sourceFilePath = sourceFile;
             sourceFileAbsPath = filesystem::absolute(sourceFilePath);
         } else if (curr_arg.starts_with("compile_commands_path=")) {
             compileCommandsFile = curr_arg.substr(22);
+        } else if (curr_arg.starts_with("ast_file_path=")) {
+            options.ast_file = curr_arg.substr(14);
+        } else if (curr_arg.starts_with("depfile_path=")) {
+            options.dep_file = curr_arg.substr(13);
+        } else if (curr_arg.starts_with("manifest_path=")) {
+            options.manifest_file = filesystem::absolute(curr_arg.substr(14)).string();
+        } else if (curr_arg.starts_with("jobs=")) {
+            jobs = parsePositiveInt(curr_arg.substr(5));
+            if (jobs < 1) {
+                cout << "\n\nInvalid job count " << curr_arg.substr(5) << "\n";
+                exit(1);
+            }
         } else if (curr_arg == "--print") {
-            print_to_console = true;
+            options.print_to_console = true;
         } else if (curr_arg == "--dump") {
-            dump_ast = true;
+            options.dump_ast = true;
+        } else if (curr_arg == "--compact") {
+            options.compact_dump = true;
+        } else if (curr_arg == "--shard") {
+            options.shard = true;
         }
     }
 
-    if (system("clang++ -v") == -1) {
+    if (!options.ast_file.length() && system("clang++ -v") == -1) {
         cout << "No clang++ found, exiting\n";
         exit(1);
     }
 
-    if (!headerFile.length()) {
+    if (headerFiles.empty()) {
         cout << "\n\nPlease set header_file_path\n";
         exit(1);
     }
 
+    // outputs are named after the header file name, two headers with the same name would write the same files
+    set<string> headerFileNames;
+    for (auto &headerFile : headerFiles) {
+        string headerFileName = filesystem::path(headerFile).stem().string();
+        if (!headerFileNames.insert(headerFileName).second) {
+            cout << "\n\nMultiple header files named " << headerFileName
+                 << ", their meta headers would overwrite each other, run them separately\n";
+            exit(1);
+        }
+    }
+
+    if (headerFiles.size() > 1 && (options.ast_file.length() || options.dep_file.length())) {
+        cout << "\n\nast_file_path and depfile_path can only be used with a single header_file_path\n";
+        exit(1);
+    }
+
     if (!sourceFile.length() && compileCommandsFile.length()) {
         cout << "\n\nPlease set source_file_path\n";
         exit(1);
     }
 
-    cout << "\nRunning on " << filesystem::absolute(headerFile) << "\n\n";
-
-    string additional_params;
-
     if (compileCommandsFile.length()) {
         ifstream compileCommandsStream(compileCommandsFile);
         json compileCommandsJson = json::parse(compileCommandsStream);
@@ -507,12 +1192,18 @@ int main(int argc, char *argv[]) {
             if (filesystem::absolute(compile_command["file"]) == sourceFileAbsPath) {
                 vector<string> params = split(compile_command["command"], ' ');
                 int param_index = 0;
+                bool skip_next = false;
                 for (const auto &param : params) {
                     if (param == "-o") {
                         break;
                     }
-                    if (param_index >= 1) {
-                        additional_params += " " + param;
+                    // drop dependency generation flags, they would overwrite the depfile of the object file
+                    if (skip_next || param == "-MD" || param == "-MMD" || param == "-MP") {
+                        skip_next = false;
+                    } else if (param == "-MF" || param == "-MT" || param == "-MQ") {
+                        skip_next = true;
+                    } else if (param_index >= 1) {
+                        options.additional_params += " " + param;
                         cout << param << "\n";
                     }
                     param_index++;
@@ -522,34 +1213,30 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    auto start_clang = chrono::steady_clock::now();
-    stringstream ss(exec("clang++" + additional_params +
-                         " -Xclang -ast-dump -fsyntax-only -fno-color-diagnostics -Wno-visibility -std=c++17 '" +
-                         headerFile + "'"));
-    auto end_clang = chrono::steady_clock::now();
+    JobServer job_server(jobs);
 
-    if (dump_ast) {
-        ofstream ast_file(headerFileName + "_ast");
-        ast_file << ss.str();
-        ast_file.close();
+    // workers mostly wait for clang, the jobserver decides how many of them run clang at the same time
+    atomic<size_t> next_header = 0;
+    atomic<bool> failed = false;
+    auto worker = [&] {
+        for (size_t i = next_header++; i < headerFiles.size(); i = next_header++) {
+            if (!generateForHeader(headerFiles[i], options, job_server)) {
+                failed = true;
+            }
+        }
+    };
+
+    // under a jobserver the tokens limit the concurrency, the pool is still capped at the cores of the host
+    size_t max_workers = job_server.isConnected() ? max(1u, thread::hardware_concurrency()) : (size_t)jobs;
+    size_t worker_count = min(headerFiles.size(), max_workers);
+    vector<thread> workers;
+    for (size_t i = 1; i < worker_count; i++) {
+        workers.emplace_back(worker);
     }
-
-    auto start_parse = chrono::steady_clock::now();
-
-    Parser parser(ss);
-    parser.parseLevel();
-
-    if (print_to_console) {
-        parser.dump();
+    worker();
+    for (auto &w : workers) {
+        w.join();
     }
 
-    ofstream meta(headerFileName + "_meta.hpp");
-    meta << parser.generateMetaCode(headerFile);
-    meta.close();
-
-    cout << "\nBuilt in: "
-         << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_parse).count() << "ms + "
-         << chrono::duration_cast<chrono::milliseconds>(end_clang - start_clang).count() << "ms clang ast generation\n";
-
-    return 0;
-}
\ No newline at end of file
+    return failed ? 1 : 0;
+}
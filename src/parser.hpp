@@ -21,6 +21,8 @@ struct Field {
     std::string type;
     std::vector<std::string> attributes;
     bool not_reflectable;
+    // desugared type as printed by clang, fully qualified
+    std::string canonical_type;
     std::string getAttributes() const;
     friend std::ostream &operator<<(std::ostream &os, const Field &field);
 };
@@ -46,11 +48,17 @@ struct Struct {
     TemplateDeclaration template_params;
 
     bool is_reflectable = false;
+    // file the struct is defined in as printed in the AST, only tracked if requested
+    std::string source_file;
 
     std::string getTemplateHeading() const;
 
     std::string getLocation(bool include_name) const;
     std::string getName() const;
+    // fully qualified name without template arguments
+    std::string getQualifiedName() const;
+    // file name of the meta header shard of this struct
+    std::string getShardName() const;
 
     bool isNestedInTemplates() const;
 
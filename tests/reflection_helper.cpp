@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../include/MetaCompiler/ReflectionHelper.hpp"
+
+// TypeOf specializations are written by hand the way the metacompiler generates them, only the layouts are needed
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winvalid-offsetof"
+
+struct inner {
+    int a;
+    int b;
+};
+
+// no operator==, only comparable through its layout
+struct reflected {
+    int x;
+    std::string name;
+};
+
+// neither operator== nor a layout
+struct opaque {
+    int x;
+};
+
+struct outer {
+    int a;
+    int b;
+    inner in;
+    std::string s;
+    std::vector<reflected> reflected_vector;
+    float f[2];
+    std::string strings[2];
+};
+
+// building the layout must not compare the elements, only equal and hash would fail to compile
+struct holds_opaque {
+    int x;
+    std::vector<opaque> opaque_vector;
+};
+
+struct with_const {
+    int a;
+    const int c;
+    std::string s;
+};
+
+template <> struct Meta::TypeOf<inner> {
+    using type_t = inner;
+    static constexpr std::array<Meta::FieldLayout, 2> layout{{
+        Meta::field<int>(offsetof(type_t, a)),
+        Meta::field<int>(offsetof(type_t, b)),
+    }};
+};
+
+template <> struct Meta::TypeOf<reflected> {
+    using type_t = reflected;
+    static constexpr std::array<Meta::FieldLayout, 2> layout{{
+        Meta::field<int>(offsetof(type_t, x)),
+        Meta::field<std::string>(offsetof(type_t, name)),
+    }};
+};
+
+template <> struct Meta::TypeOf<outer> {
+    using type_t = outer;
+    static constexpr std::array<Meta::FieldLayout, 8> layout{{
+        Meta::field<int>(offsetof(type_t, a)),
+        Meta::field<int>(offsetof(type_t, b)),
+        Meta::field<int>(offsetof(type_t, in) + offsetof(inner, a)),
+        Meta::field<int>(offsetof(type_t, in) + offsetof(inner, b)),
+        Meta::field<std::string>(offsetof(type_t, s)),
+        Meta::field<std::vector<reflected>>(offsetof(type_t, reflected_vector)),
+        Meta::field<float[2]>(offsetof(type_t, f)),
+        Meta::field<std::string[2]>(offsetof(type_t, strings)),
+    }};
+};
+
+template <> struct Meta::TypeOf<holds_opaque> {
+    using type_t = holds_opaque;
+    static constexpr std::array<Meta::FieldLayout, 2> layout{{
+        Meta::field<int>(offsetof(type_t, x)),
+        Meta::field<std::vector<opaque>>(offsetof(type_t, opaque_vector)),
+    }};
+};
+
+template <> struct Meta::TypeOf<with_const> {
+    using type_t = with_const;
+    static constexpr std::array<Meta::FieldLayout, 3> layout{{
+        Meta::field<int>(offsetof(type_t, a)),
+        Meta::field<const int>(offsetof(type_t, c)),
+        Meta::field<std::string>(offsetof(type_t, s)),
+    }};
+};
+
+#pragma GCC diagnostic pop
+
+// the flattened byte fields are merged into one range
+static_assert(Meta::detail::FlatLayout<outer>::merged.count == 5);
+static_assert(Meta::detail::FlatLayout<outer>::merged.fields[0].size == 4 * sizeof(int));
+// operations the field type does not support are left empty instead of failing to compile
+static_assert(Meta::TypeOf<holds_opaque>::layout[1].equal == nullptr);
+static_assert(Meta::TypeOf<holds_opaque>::layout[1].hash == nullptr);
+// const fields are never written
+static_assert(Meta::TypeOf<with_const>::layout[1].kind == Meta::FieldKind::Value);
+static_assert(Meta::TypeOf<with_const>::layout[1].copy == nullptr);
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                                               \
+    if (!(condition)) {                                                                                                \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                                      \
+        failures++;                                                                                                    \
+    }
+
+int main() {
+    outer a{1, 2, {3, 4}, "s", {{5, "r"}}, {0.5f, 1.5f}, {"x", "y"}};
+    outer b = a;
+    CHECK(Meta::equal(a, b));
+    CHECK(Meta::hash(a) == Meta::hash(b));
+
+    b.in.b = 5;
+    CHECK(!Meta::equal(a, b));
+    b = a;
+    b.reflected_vector[0].name = "other";
+    CHECK(!Meta::equal(a, b));
+    b = a;
+    b.f[1] = 2.5f;
+    CHECK(!Meta::equal(a, b));
+    b = a;
+    b.strings[0] = "z";
+    CHECK(!Meta::equal(a, b));
+    CHECK(Meta::hash(a) != Meta::hash(b));
+
+    outer c{};
+    Meta::copy(c, a);
+    CHECK(c.in.a == 3 && c.s == "s" && c.f[1] == 1.5f && c.strings[1] == "y" && c.reflected_vector[0].x == 5);
+    CHECK(Meta::equal(a, c));
+
+    holds_opaque o{1, {{2}, {3}}};
+    holds_opaque p{};
+    Meta::copy(p, o);
+    CHECK(p.x == 1 && p.opaque_vector.size() == 2 && p.opaque_vector[1].x == 3);
+
+    with_const x{1, 2, "a"};
+    with_const y{1, 2, "a"};
+    with_const z{1, 3, "a"};
+    CHECK(Meta::equal(x, y));
+    CHECK(!Meta::equal(x, z));
+    CHECK(Meta::hash(x) == Meta::hash(y));
+
+    return failures ? 1 : 0;
+}